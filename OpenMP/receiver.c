@@ -1,14 +1,19 @@
 // File: receiver.c
+#define _GNU_SOURCE  // fallocate
 #include <gtk/gtk.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
 #include <stdint.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <time.h>
+#include <omp.h>
 #include "rsa_omp.h"
+#include "transfer.h"
 
 // RSA Keys (For demonstration purposes; in practice, use secure key generation and storage)
 const uint64_t PUBLIC_KEY_E = 65537;
@@ -29,119 +34,357 @@ void update_text_view(const char *message) {
     gtk_text_buffer_insert(buffer, &end, message, -1);
 }
 
-// Function to decrypt the file
-int decrypt_file(const char *input_path, const char *output_path, uint64_t d, uint64_t n, char *decryption_info) {
-    FILE *fin = fopen(input_path, "rb");
-    if (!fin) {
-        perror("fopen");
+// Output of the transfer in progress
+const char *DECRYPTED_FILE = "received_file.png";
+// Completed-chunk bitmap kept next to the output so an interrupted transfer can resume
+const char *PROGRESS_FILE = "received_file.png.part";
+
+// State of the transfer in progress, shared by all data streams
+struct transfer {
+    int active;
+    int out_fd;             // Pre-allocated output file, written with pwrite
+    int progress_fd;
+    uint64_t plain_size;
+    uint32_t chunk_size;
+    uint64_t file_id;       // Hash of the ciphertext, identifies the file being sent
+    uint32_t num_chunks;
+    uint32_t done_chunks;
+    uint8_t *bitmap;
+    struct timespec start_time;
+    double decrypt_time;    // Seconds spent in decrypt_chunk, summed over all streams
+    uint32_t generation;    // Bumped whenever the transfer is closed, so stale chunks are dropped
+};
+
+struct transfer current_transfer = {0};
+pthread_mutex_t transfer_lock = PTHREAD_MUTEX_INITIALIZER;
+// Data streams currently decrypting, used to share the cores between their OpenMP teams
+int active_streams = 0;
+
+// Progress file layout: plain_size (u64), chunk_size (u32), file_id (u64), bitmap
+#define PROGRESS_HEADER_SIZE (2 * sizeof(uint64_t) + sizeof(uint32_t))
+
+void close_transfer(struct transfer *t) {
+    if (t->out_fd >= 0) {
+        close(t->out_fd);
+    }
+    if (t->progress_fd >= 0) {
+        close(t->progress_fd);
+    }
+    free(t->bitmap);
+    uint32_t generation = t->generation;
+    memset(t, 0, sizeof(*t));
+    t->generation = generation + 1;
+}
+
+// Load the completed-chunk bitmap if the progress file matches this transfer
+int load_progress(int fd, struct transfer *t) {
+    uint64_t plain_size;
+    uint32_t chunk_size;
+    uint64_t file_id;
+    if (pread(fd, &plain_size, sizeof(plain_size), 0) != sizeof(plain_size) ||
+        pread(fd, &chunk_size, sizeof(chunk_size), sizeof(plain_size)) != sizeof(chunk_size) ||
+        pread(fd, &file_id, sizeof(file_id), sizeof(plain_size) + sizeof(chunk_size)) != sizeof(file_id) ||
+        plain_size != t->plain_size || chunk_size != t->chunk_size || file_id != t->file_id) {
         return -1;
     }
 
-    FILE *fout = fopen(output_path, "wb");
-    if (!fout) {
-        perror("fopen");
-        fclose(fin);
+    size_t bitmap_len = ((size_t)t->num_chunks + 7) / 8;
+    if (pread(fd, t->bitmap, bitmap_len, PROGRESS_HEADER_SIZE) != (ssize_t)bitmap_len) {
         return -1;
     }
 
-    // Read encrypted bytes and decrypt each
-    uint64_t encrypted_byte;
-    uint64_t decrypted_byte;
-    while (fread(&encrypted_byte, sizeof(encrypted_byte), 1, fin) == 1) {
-        decrypted_byte = modular_exponentiation_openmp(encrypted_byte, d, n);
-        fputc((unsigned char)decrypted_byte, fout);
+    for (uint32_t i = 0; i < t->num_chunks; i++) {
+        if (t->bitmap[i / 8] & (1 << (i % 8))) {
+            t->done_chunks++;
+        }
     }
+    return 0;
+}
+
+// Close a transfer whose chunks have all been written and report it.
+// Must be called with transfer_lock held.
+void finish_transfer(struct transfer *t) {
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double transfer_time = (end_time.tv_sec - t->start_time.tv_sec) +
+                           (end_time.tv_nsec - t->start_time.tv_nsec) / 1e9;
+    double decrypt_time = t->decrypt_time;
 
-    fclose(fin);
-    fclose(fout);
+    close_transfer(t);
+    unlink(PROGRESS_FILE);
 
     // Prepare decryption info
-    sprintf(decryption_info, "Decryption:\nPrivate Key (d, n): (%llu, %llu)\n", d, n);
+    char decryption_info[512];
+    snprintf(decryption_info, sizeof(decryption_info),
+             "File received.\nTransfer time (since last query): %.3f seconds\n"
+             "Decryption:\nPrivate Key (d, n): (%llu, %llu)\nTime taken: %.3f seconds (summed over streams)\n",
+             transfer_time, (unsigned long long)PRIVATE_KEY_D, (unsigned long long)PUBLIC_KEY_N, decrypt_time);
+    update_text_view(decryption_info);
+    update_text_view("Decrypted file saved as 'received_file.png'.\n");
+}
+
+// Start a new transfer, or resume the previous one if its progress file matches.
+// Must be called with transfer_lock held.
+int open_transfer(uint64_t plain_size, uint32_t chunk_size, uint64_t file_id) {
+    struct transfer *t = &current_transfer;
+    if (t->active && t->plain_size == plain_size && t->chunk_size == chunk_size && t->file_id == file_id) {
+        return 0;
+    }
+    close_transfer(t);
+
+    t->out_fd = -1;
+    t->progress_fd = -1;
+    t->plain_size = plain_size;
+    t->chunk_size = chunk_size;
+    t->file_id = file_id;
+    t->num_chunks = xfer_num_chunks(plain_size, chunk_size);
+    size_t bitmap_len = ((size_t)t->num_chunks + 7) / 8;
+    t->bitmap = calloc(bitmap_len + 1, 1);
+    if (!t->bitmap) {
+        perror("calloc");
+        goto fail;
+    }
+
+    t->progress_fd = open(PROGRESS_FILE, O_RDWR | O_CREAT, 0644);
+    if (t->progress_fd < 0) {
+        perror("open");
+        goto fail;
+    }
+
+    int resumed = load_progress(t->progress_fd, t) == 0;
+    t->out_fd = open(DECRYPTED_FILE, resumed ? O_WRONLY : O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (t->out_fd < 0) {
+        // The output went missing, so the recorded progress is meaningless
+        resumed = 0;
+        t->out_fd = open(DECRYPTED_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (t->out_fd < 0) {
+        perror("open");
+        goto fail;
+    }
 
+    if (!resumed) {
+        memset(t->bitmap, 0, bitmap_len);
+        t->done_chunks = 0;
+
+        // Reserve the whole output up front so chunks can land at any offset.
+        // Only filesystems without fallocate support fall back to a sparse file.
+        if (plain_size > 0 && fallocate(t->out_fd, 0, 0, (off_t)plain_size) != 0) {
+            if (errno != EOPNOTSUPP && errno != ENOSYS) {
+                perror("fallocate");
+                goto fail;
+            }
+            if (ftruncate(t->out_fd, (off_t)plain_size) != 0) {
+                perror("ftruncate");
+                goto fail;
+            }
+        }
+
+        if (ftruncate(t->progress_fd, 0) != 0 ||
+            pwrite(t->progress_fd, &plain_size, sizeof(plain_size), 0) != sizeof(plain_size) ||
+            pwrite(t->progress_fd, &chunk_size, sizeof(chunk_size), sizeof(plain_size)) != sizeof(chunk_size) ||
+            pwrite(t->progress_fd, &file_id, sizeof(file_id), sizeof(plain_size) + sizeof(chunk_size)) != sizeof(file_id) ||
+            pwrite(t->progress_fd, t->bitmap, bitmap_len, PROGRESS_HEADER_SIZE) != (ssize_t)bitmap_len) {
+            perror("pwrite");
+            goto fail;
+        }
+    }
+
+    t->active = 1;
+    clock_gettime(CLOCK_MONOTONIC, &t->start_time);
+
+    char message[256];
+    snprintf(message, sizeof(message), "%s transfer: %llu bytes in %u chunks (%u already received).\n",
+             resumed ? "Resuming" : "Starting", (unsigned long long)plain_size, t->num_chunks, t->done_chunks);
+    update_text_view(message);
+
+    // Nothing left to receive: an empty file, or a resume after the last chunk was recorded
+    if (t->done_chunks == t->num_chunks) {
+        finish_transfer(t);
+    }
     return 0;
+
+fail:
+    close_transfer(t);
+    return -1;
 }
 
-// Function to handle incoming connections
-void *handle_client(void *arg) {
-    int server_fd = *((int *)arg);
-    free(arg);
+// Record a written chunk. Must be called with transfer_lock held.
+void complete_chunk(uint32_t index) {
+    struct transfer *t = &current_transfer;
+    if (index >= t->num_chunks) {
+        fprintf(stderr, "Chunk index %u out of range\n", index);
+        return;
+    }
+    uint8_t bit = 1 << (index % 8);
+    if (t->bitmap[index / 8] & bit) {
+        return;
+    }
+    t->bitmap[index / 8] |= bit;
+    t->done_chunks++;
+    if (pwrite(t->progress_fd, &t->bitmap[index / 8], 1, PROGRESS_HEADER_SIZE + index / 8) != 1) {
+        perror("pwrite");
+    }
 
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    int new_socket;
+    if (t->done_chunks == t->num_chunks) {
+        finish_transfer(t);
+    }
+}
 
-    if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-        perror("accept");
-        pthread_exit(NULL);
+// Function to decrypt one chunk of ciphertext words into plaintext bytes.
+// Each byte is independent, so the chunk is split across a team sized to this
+// stream's share of the cores.
+void decrypt_chunk(const uint64_t *encrypted, unsigned char *decrypted, uint32_t count, uint64_t d, uint64_t n) {
+    pthread_mutex_lock(&transfer_lock);
+    int streams = active_streams > 0 ? active_streams : 1;
+    pthread_mutex_unlock(&transfer_lock);
+    int team_size = omp_get_num_procs() / streams;
+    if (team_size < 1) {
+        team_size = 1;
     }
 
-    update_text_view("Connection established.\n");
+    #pragma omp parallel for schedule(static) num_threads(team_size)
+    for (uint32_t i = 0; i < count; i++) {
+        decrypted[i] = (unsigned char)modular_exponentiation(encrypted[i], d, n);
+    }
+}
 
-    // Receive file size
-    long filesize_net;
-    if (recv(new_socket, &filesize_net, sizeof(filesize_net), 0) <= 0) {
-        perror("recv");
-        close(new_socket);
-        pthread_exit(NULL);
+// Answer a sender asking which chunks are still missing
+void handle_query(int client_fd) {
+    uint64_t plain_size;
+    uint32_t chunk_size;
+    uint64_t file_id;
+    if (recv_u64(client_fd, &plain_size) != 0 || recv_u32(client_fd, &chunk_size) != 0 ||
+        recv_u64(client_fd, &file_id) != 0 ||
+        chunk_size != XFER_CHUNK_SIZE ||
+        plain_size > (uint64_t)(UINT32_MAX - 8) * chunk_size) {
+        fprintf(stderr, "Invalid transfer query\n");
+        return;
     }
-    long filesize = ntohl(filesize_net);
 
-    // Receive file data
-    char *buffer = malloc(filesize);
-    if (!buffer) {
+    uint32_t num_chunks = xfer_num_chunks(plain_size, chunk_size);
+    size_t bitmap_len = ((size_t)num_chunks + 7) / 8;
+    uint8_t *bitmap = malloc(bitmap_len + 1);
+    if (!bitmap) {
         perror("malloc");
-        close(new_socket);
-        pthread_exit(NULL);
+        return;
     }
 
-    long total_received = 0;
-    while (total_received < filesize) {
-        ssize_t bytes = recv(new_socket, buffer + total_received, filesize - total_received, 0);
-        if (bytes <= 0) {
-            perror("recv");
-            free(buffer);
-            close(new_socket);
-            pthread_exit(NULL);
-        }
-        total_received += bytes;
+    pthread_mutex_lock(&transfer_lock);
+    if (open_transfer(plain_size, chunk_size, file_id) != 0) {
+        pthread_mutex_unlock(&transfer_lock);
+        update_text_view("Failed to prepare output file.\n");
+        free(bitmap);
+        return;
+    }
+    if (current_transfer.active) {
+        memcpy(bitmap, current_transfer.bitmap, bitmap_len);
+    } else {
+        memset(bitmap, 0xff, bitmap_len);  // Already finished, nothing to send
     }
+    pthread_mutex_unlock(&transfer_lock);
+    if (send_u32(client_fd, num_chunks) != 0 || send_all(client_fd, bitmap, bitmap_len) != 0) {
+        perror("send");
+    }
+    free(bitmap);
+}
 
-    // Save the encrypted file
-    const char *encrypted_file = "received_file.enc";
-    FILE *f = fopen(encrypted_file, "wb");
-    if (!f) {
-        perror("fopen");
-        free(buffer);
-        close(new_socket);
-        pthread_exit(NULL);
+// Receive offset-tagged chunks, decrypt them and write each at its offset
+void handle_data(int client_fd) {
+    pthread_mutex_lock(&transfer_lock);
+    active_streams++;
+    pthread_mutex_unlock(&transfer_lock);
+
+    uint64_t *encrypted = malloc(XFER_CHUNK_SIZE * XFER_CIPHER_WORD);
+    unsigned char *decrypted = malloc(XFER_CHUNK_SIZE);
+    if (!encrypted || !decrypted) {
+        perror("malloc");
+        goto out;
     }
-    fwrite(buffer, 1, filesize, f);
-    fclose(f);
-    free(buffer);
-    close(new_socket);
 
-    update_text_view("File received.\n");
+    while (1) {
+        uint64_t offset;
+        uint32_t count;
+        int rc = recv_u64(client_fd, &offset);
+        if (rc == 1) {
+            break;  // Sender finished this stream
+        }
+        if (rc != 0 || recv_u32(client_fd, &count) != 0) {
+            perror("recv");
+            goto out;
+        }
 
-    // Decrypt the file
-    const char *decrypted_file = "received_file.png";  // Change to PNG format
-    char decryption_info[512] = {0};
-    clock_t start_time = clock();
+        // Validate the chunk against the transfer it belongs to
+        pthread_mutex_lock(&transfer_lock);
+        struct transfer *t = &current_transfer;
+        int valid = t->active && offset < t->plain_size && offset % t->chunk_size == 0 &&
+                    count == (t->plain_size - offset < t->chunk_size ? t->plain_size - offset : t->chunk_size);
+        uint32_t generation = t->generation;
+        pthread_mutex_unlock(&transfer_lock);
+        if (!valid) {
+            fprintf(stderr, "Unexpected chunk at offset %llu\n", (unsigned long long)offset);
+            goto out;
+        }
 
-    if (decrypt_file(encrypted_file, decrypted_file, PRIVATE_KEY_D, PUBLIC_KEY_N, decryption_info) != 0) {
-        update_text_view("Decryption failed.\n");
-        pthread_exit(NULL);
+        if (recv_all(client_fd, encrypted, (size_t)count * XFER_CIPHER_WORD) != 0) {
+            perror("recv");
+            goto out;
+        }
+
+        struct timespec decrypt_start, decrypt_end;
+        clock_gettime(CLOCK_MONOTONIC, &decrypt_start);
+        decrypt_chunk(encrypted, decrypted, count, PRIVATE_KEY_D, PUBLIC_KEY_N);
+        clock_gettime(CLOCK_MONOTONIC, &decrypt_end);
+
+        // Write only if the transfer was not replaced while decrypting, since a new
+        // transfer truncates the same output file
+        pthread_mutex_lock(&transfer_lock);
+        if (t->generation != generation) {
+            pthread_mutex_unlock(&transfer_lock);
+            fprintf(stderr, "Dropping chunk at offset %llu from a replaced transfer\n", (unsigned long long)offset);
+            goto out;
+        }
+        if (pwrite(t->out_fd, decrypted, count, (off_t)offset) != (ssize_t)count) {
+            pthread_mutex_unlock(&transfer_lock);
+            perror("pwrite");
+            goto out;
+        }
+        t->decrypt_time += (decrypt_end.tv_sec - decrypt_start.tv_sec) +
+                           (decrypt_end.tv_nsec - decrypt_start.tv_nsec) / 1e9;
+        complete_chunk((uint32_t)(offset / t->chunk_size));
+        pthread_mutex_unlock(&transfer_lock);
     }
 
-    clock_t end_time = clock();
-    double time_taken = (double)(end_time - start_time) / CLOCKS_PER_SEC;
-    update_text_view(decryption_info);
+out:
+    pthread_mutex_lock(&transfer_lock);
+    active_streams--;
+    pthread_mutex_unlock(&transfer_lock);
+    free(encrypted);
+    free(decrypted);
+}
+
+// Function to handle incoming connections
+void *handle_client(void *arg) {
+    int client_fd = *((int *)arg);
+    free(arg);
 
-    char time_message[256];
-    snprintf(time_message, sizeof(time_message), "Time taken: %.3f seconds\n", time_taken);
-    update_text_view(time_message);
+    uint32_t type;
+    if (recv_u32(client_fd, &type) != 0) {
+        perror("recv");
+        close(client_fd);
+        pthread_exit(NULL);
+    }
 
-    update_text_view("Decrypted file saved as 'received_file.png'.\n");
+    if (type == XFER_QUERY) {
+        update_text_view("Connection established.\n");
+        handle_query(client_fd);
+    } else if (type == XFER_DATA) {
+        handle_data(client_fd);
+    } else {
+        fprintf(stderr, "Unknown message type %u\n", type);
+    }
 
+    close(client_fd);
     pthread_exit(NULL);
 }
 
@@ -172,7 +415,7 @@ void *start_server(void *arg) {
         pthread_exit(NULL);
     }
 
-    if (listen(server_fd, 3) < 0) {
+    if (listen(server_fd, XFER_MAX_STREAMS + 1) < 0) {
         perror("listen");
         close(server_fd);
         pthread_exit(NULL);
@@ -181,8 +424,17 @@ void *start_server(void *arg) {
     update_text_view("Server set. Waiting for connection...\n");
 
     while (1) {
+        struct sockaddr_in client_address;
+        socklen_t addrlen = sizeof(client_address);
+        int client_fd = accept(server_fd, (struct sockaddr *)&client_address, &addrlen);
+        if (client_fd < 0) {
+            perror("accept");
+            continue;
+        }
+
+        // One thread per connection, so parallel streams are decrypted concurrently
         int *new_socket = malloc(sizeof(int));
-        *new_socket = server_fd;
+        *new_socket = client_fd;
         pthread_t thread_id;
         pthread_create(&thread_id, NULL, handle_client, new_socket);
         pthread_detach(thread_id);
@@ -5,6 +5,22 @@ uint64_t modular_multiply(uint64_t a, uint64_t b, uint64_t mod) {
     return ((__int128)a * b) % mod;
 }
 
+// Serial square-and-multiply, for callers that parallelize across many values
+uint64_t modular_exponentiation(uint64_t base, uint64_t exponent, uint64_t modulus) {
+    uint64_t result = 1;
+    base = base % modulus;
+
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result = modular_multiply(result, base, modulus);
+        }
+        base = modular_multiply(base, base, modulus);
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
 uint64_t modular_exponentiation_openmp(uint64_t base, uint64_t exponent, uint64_t modulus) {
     uint64_t result = 1;
     base = base % modulus;
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 uint64_t modular_multiply(uint64_t a, uint64_t b, uint64_t mod);
+uint64_t modular_exponentiation(uint64_t base, uint64_t exponent, uint64_t modulus);
 uint64_t modular_exponentiation_openmp(uint64_t base, uint64_t exponent, uint64_t modulus);
 
 #endif
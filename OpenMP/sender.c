@@ -6,8 +6,12 @@
 #include <stdint.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <time.h>
 #include "rsa_omp.h"
+#include "transfer.h"
 
 // RSA Keys (For demonstration purposes; in practice, use secure key generation and storage)
 const uint64_t PUBLIC_KEY_E = 65537;
@@ -19,6 +23,7 @@ GtkWidget *button_send;
 GtkWidget *text_view;
 GtkWidget *entry_ip;
 GtkWidget *entry_port;
+GtkWidget *entry_streams;
 GtkWidget *entry_file;
 
 // Selected file path
@@ -93,20 +98,14 @@ int encrypt_file(const char *input_path, const char *output_path, uint64_t e, ui
     return 0;
 }
 
-// Function to send the file via socket
-int send_file_socket(const char *ip, int port, const char *file_path, char *encryption_info) {
+// Function to open a connection to the receiver
+int connect_to_receiver(const char *ip, int port) {
     int sockfd;
     struct sockaddr_in server_addr;
-    FILE *f = fopen(file_path, "rb");
-    if (!f) {
-        perror("fopen");
-        return -1;
-    }
 
     // Create socket
     if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         perror("Socket creation error");
-        fclose(f);
         return -1;
     }
 
@@ -117,7 +116,6 @@ int send_file_socket(const char *ip, int port, const char *file_path, char *encr
     if (inet_pton(AF_INET, ip, &server_addr.sin_addr) <= 0) {
         perror("Invalid address/ Address not supported");
         close(sockfd);
-        fclose(f);
         return -1;
     }
 
@@ -125,29 +123,198 @@ int send_file_socket(const char *ip, int port, const char *file_path, char *encr
     if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("Connection Failed");
         close(sockfd);
-        fclose(f);
         return -1;
     }
 
-    // Send the file size first
-    fseek(f, 0, SEEK_END);
-    long filesize = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    long filesize_net = htonl(filesize);
-    send(sockfd, &filesize_net, sizeof(filesize_net), 0);
+    return sockfd;
+}
+
+// Work shared by the parallel send streams
+struct send_job {
+    const char *ip;
+    int port;
+    int fd;                 // Encrypted file, read with pread
+    uint64_t plain_size;
+    uint32_t *chunks;       // Indices of the chunks the receiver is missing
+    uint32_t num_chunks;
+    uint32_t next_chunk;
+    pthread_mutex_t lock;
+};
+
+// Send thread: claims missing chunks one at a time and sends them on its own connection
+void *send_stream(void *arg) {
+    struct send_job *job = arg;
+    intptr_t status = -1;
+
+    int sockfd = connect_to_receiver(job->ip, job->port);
+    if (sockfd < 0) {
+        return (void *)status;
+    }
+
+    char *buffer = malloc(XFER_CHUNK_SIZE * XFER_CIPHER_WORD);
+    if (!buffer) {
+        perror("malloc");
+        close(sockfd);
+        return (void *)status;
+    }
+
+    if (send_u32(sockfd, XFER_DATA) != 0) {
+        perror("send");
+        goto out;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        uint32_t i = job->next_chunk < job->num_chunks ? job->next_chunk++ : UINT32_MAX;
+        pthread_mutex_unlock(&job->lock);
+        if (i == UINT32_MAX) {
+            break;
+        }
+
+        uint64_t offset = (uint64_t)job->chunks[i] * XFER_CHUNK_SIZE;
+        uint64_t remaining = job->plain_size - offset;
+        uint32_t count = remaining < XFER_CHUNK_SIZE ? (uint32_t)remaining : XFER_CHUNK_SIZE;
+        size_t cipher_len = (size_t)count * XFER_CIPHER_WORD;
+
+        if (pread(job->fd, buffer, cipher_len, (off_t)(offset * XFER_CIPHER_WORD)) != (ssize_t)cipher_len) {
+            perror("pread");
+            goto out;
+        }
+
+        if (send_u64(sockfd, offset) != 0 || send_u32(sockfd, count) != 0 ||
+            send_all(sockfd, buffer, cipher_len) != 0) {
+            perror("send");
+            goto out;
+        }
+    }
+    status = 0;
+
+out:
+    free(buffer);
+    close(sockfd);
+    return (void *)status;
+}
+
+// Function to send the file via socket, split into chunks over num_streams parallel connections
+int send_file_socket(const char *ip, int port, const char *file_path, int num_streams, char *encryption_info) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        close(fd);
+        return -1;
+    }
+    uint64_t plain_size = (uint64_t)st.st_size / XFER_CIPHER_WORD;
+
+    uint64_t file_id;
+    if (xfer_file_id(fd, &file_id) != 0) {
+        perror("pread");
+        close(fd);
+        return -1;
+    }
+
+    // Ask the receiver which chunks it already has
+    int sockfd = connect_to_receiver(ip, port);
+    if (sockfd < 0) {
+        close(fd);
+        return -1;
+    }
 
-    // Send the file data
-    char buffer[1024];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
-        send(sockfd, buffer, bytes_read, 0);
+    uint32_t total_chunks;
+    if (send_u32(sockfd, XFER_QUERY) != 0 || send_u64(sockfd, plain_size) != 0 ||
+        send_u32(sockfd, XFER_CHUNK_SIZE) != 0 || send_u64(sockfd, file_id) != 0 ||
+        recv_u32(sockfd, &total_chunks) != 0 ||
+        total_chunks != xfer_num_chunks(plain_size, XFER_CHUNK_SIZE)) {
+        fprintf(stderr, "Transfer query failed\n");
+        close(sockfd);
+        close(fd);
+        return -1;
     }
 
-    fclose(f);
+    size_t bitmap_len = ((size_t)total_chunks + 7) / 8;
+    uint8_t *bitmap = malloc(bitmap_len + 1);
+    uint32_t *chunks = malloc(((size_t)total_chunks + 1) * sizeof(uint32_t));
+    if (!bitmap || !chunks || recv_all(sockfd, bitmap, bitmap_len) != 0) {
+        fprintf(stderr, "Transfer query failed\n");
+        free(bitmap);
+        free(chunks);
+        close(sockfd);
+        close(fd);
+        return -1;
+    }
     close(sockfd);
 
+    struct send_job job = {
+        .ip = ip,
+        .port = port,
+        .fd = fd,
+        .plain_size = plain_size,
+        .chunks = chunks,
+        .num_chunks = 0,
+        .next_chunk = 0,
+    };
+    for (uint32_t i = 0; i < total_chunks; i++) {
+        if (!(bitmap[i / 8] & (1 << (i % 8)))) {
+            chunks[job.num_chunks++] = i;
+        }
+    }
+    free(bitmap);
+
+    if (num_streams < 1) {
+        num_streams = 1;
+    }
+    if (num_streams > XFER_MAX_STREAMS) {
+        num_streams = XFER_MAX_STREAMS;
+    }
+    if ((uint32_t)num_streams > job.num_chunks) {
+        num_streams = job.num_chunks;
+    }
+
+    // Send the missing chunks
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_t threads[XFER_MAX_STREAMS];
+    int started = 0;
+    int status = 0;
+    for (int i = 0; i < num_streams; i++) {
+        if (pthread_create(&threads[i], NULL, send_stream, &job) != 0) {
+            perror("pthread_create");
+            status = -1;
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        void *result;
+        pthread_join(threads[i], &result);
+        if ((intptr_t)result != 0) {
+            status = -1;
+        }
+    }
+    // A stream may die before claiming its share; the others keep draining the queue
+    if (job.next_chunk < job.num_chunks) {
+        status = -1;
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    uint32_t skipped = total_chunks - job.num_chunks;
+    free(chunks);
+    close(fd);
+
+    if (status != 0) {
+        return -1;
+    }
+
     // Update encryption info
-    strcat(encryption_info, "File encrypted and sent successfully.\n");
+    char message[256];
+    snprintf(message, sizeof(message), "File encrypted and sent successfully.\n"
+             "%u of %u chunks sent over %d streams (%u already received).\n",
+             total_chunks - skipped, total_chunks, num_streams, skipped);
+    strcat(encryption_info, message);
 
     return 0;
 }
@@ -157,6 +324,7 @@ void on_send_file(GtkWidget *widget, gpointer data) {
     const char *ip = gtk_entry_get_text(GTK_ENTRY(entry_ip));
     const char *port_str = gtk_entry_get_text(GTK_ENTRY(entry_port));
     int port = atoi(port_str);
+    int num_streams = atoi(gtk_entry_get_text(GTK_ENTRY(entry_streams)));
     const char *file_path = gtk_entry_get_text(GTK_ENTRY(entry_file));
 
     if (strlen(file_path) == 0) {
@@ -177,7 +345,7 @@ void on_send_file(GtkWidget *widget, gpointer data) {
     update_text_view(encryption_info);
 
     // Send the encrypted file
-    if (send_file_socket(ip, port, encrypted_file_path, encryption_info) != 0) {
+    if (send_file_socket(ip, port, encrypted_file_path, num_streams, encryption_info) != 0) {
         update_text_view("Failed to send the file.\n");
         return;
     }
@@ -217,6 +385,15 @@ int main(int argc, char *argv[]) {
     gtk_box_pack_start(GTK_BOX(hbox_port), entry_port, TRUE, TRUE, 5);
     gtk_box_pack_start(GTK_BOX(vbox), hbox_port, FALSE, FALSE, 5);
 
+    // Parallel Streams Entry
+    GtkWidget *hbox_streams = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    GtkWidget *label_streams = gtk_label_new("Parallel Streams:");
+    entry_streams = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(entry_streams), "4"); // Default stream count
+    gtk_box_pack_start(GTK_BOX(hbox_streams), label_streams, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(hbox_streams), entry_streams, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox_streams, FALSE, FALSE, 5);
+
     // File Selection
     GtkWidget *hbox_file = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
     GtkWidget *label_file = gtk_label_new("Selected File:");
@@ -0,0 +1,95 @@
+#include "transfer.h"
+#include <endian.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// Send the whole buffer, retrying on short writes
+int send_all(int sockfd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(sockfd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Receive exactly len bytes. Returns 1 if the peer closed the connection
+// before the first byte, -1 on error or a truncated read, 0 on success.
+int recv_all(int sockfd, void *buf, size_t len) {
+    char *p = buf;
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = recv(sockfd, p + total, len - total, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0 && total == 0) {
+            return 1;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        total += n;
+    }
+    return 0;
+}
+
+int send_u32(int sockfd, uint32_t value) {
+    uint32_t value_net = htobe32(value);
+    return send_all(sockfd, &value_net, sizeof(value_net));
+}
+
+int send_u64(int sockfd, uint64_t value) {
+    uint64_t value_net = htobe64(value);
+    return send_all(sockfd, &value_net, sizeof(value_net));
+}
+
+int recv_u32(int sockfd, uint32_t *value) {
+    uint32_t value_net;
+    int rc = recv_all(sockfd, &value_net, sizeof(value_net));
+    if (rc == 0) {
+        *value = be32toh(value_net);
+    }
+    return rc;
+}
+
+int recv_u64(int sockfd, uint64_t *value) {
+    uint64_t value_net;
+    int rc = recv_all(sockfd, &value_net, sizeof(value_net));
+    if (rc == 0) {
+        *value = be64toh(value_net);
+    }
+    return rc;
+}
+
+uint32_t xfer_num_chunks(uint64_t plain_size, uint32_t chunk_size) {
+    return (uint32_t)((plain_size + chunk_size - 1) / chunk_size);
+}
+
+// FNV-1a hash of the whole file, used to tell transfers of equal size apart
+int xfer_file_id(int fd, uint64_t *id) {
+    uint64_t hash = 14695981039346656037ULL;
+    unsigned char buffer[64 * 1024];
+    off_t offset = 0;
+    ssize_t n;
+    while ((n = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            hash = (hash ^ buffer[i]) * 1099511628211ULL;
+        }
+        offset += n;
+    }
+    if (n < 0) {
+        return -1;
+    }
+    *id = hash;
+    return 0;
+}
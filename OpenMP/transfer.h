@@ -0,0 +1,39 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Multi-stream transfer protocol shared by sender and receiver.
+//
+// The encrypted file is split into chunks of XFER_CHUNK_SIZE plaintext bytes
+// (XFER_CHUNK_SIZE * XFER_CIPHER_WORD bytes of ciphertext). Every connection
+// starts with a uint32 message type, all integers are in network byte order:
+//
+//   XFER_QUERY: -> plain_size (u64), chunk_size (u32), file_id (u64)
+//               <- num_chunks (u32), bitmap of completed chunks
+//   XFER_DATA:  -> { offset (u64), count (u32), count ciphertext words }...
+//                  until the sender closes the connection
+//
+// The sender issues one XFER_QUERY, then sends the missing chunks over
+// several XFER_DATA connections in parallel. file_id is a hash of the
+// ciphertext, so the receiver only resumes a transfer of the same file.
+
+#define XFER_QUERY 1
+#define XFER_DATA  2
+
+#define XFER_CHUNK_SIZE  (64 * 1024)        // Plaintext bytes per chunk
+#define XFER_CIPHER_WORD sizeof(uint64_t)   // Ciphertext bytes per plaintext byte
+#define XFER_MAX_STREAMS 16
+
+int send_all(int sockfd, const void *buf, size_t len);
+int recv_all(int sockfd, void *buf, size_t len);
+int send_u32(int sockfd, uint32_t value);
+int send_u64(int sockfd, uint64_t value);
+int recv_u32(int sockfd, uint32_t *value);
+int recv_u64(int sockfd, uint64_t *value);
+
+uint32_t xfer_num_chunks(uint64_t plain_size, uint32_t chunk_size);
+int xfer_file_id(int fd, uint64_t *id);
+
+#endif